@@ -11,10 +11,22 @@
 #include <math.h>
 #include <time.h>
 
-#define BR_VERSION "1.1.1a"
+#define BR_VERSION "1.1.2"
 
 #include <bruter.h>
 
+// allocator hooks, define them before including this header to use your own allocator
+// strings, buffers and parser temporaries made by bruter-representation go through them,
+// buffers in the context are freed with BR_FREE, so create them with BR_MALLOC or the br_str_* functions,
+// lists and keys belong to bruter.h and always use its allocator, no matter what is defined here
+#ifndef BR_MALLOC
+#define BR_MALLOC(size) malloc(size)
+#endif
+
+#ifndef BR_FREE
+#define BR_FREE(ptr) free(ptr)
+#endif
+
 // BRUTER-REPRESENTATION TYPES
 enum BR_TYPES
 {
@@ -29,6 +41,62 @@ enum BR_TYPES
     BR_TYPE_MACRO              =  7,   // macro, a special kind of function that is run during parsing
 };
 
+// BRUTER-REPRESENTATION ARGUMENT KINDS
+// spreads are marked by their key in the args list, "..." or "...%" followed by "+" if the list has spreads too, the parser never gives those keys to a variable
+// the types of the list are never read, so any typed list can be used as args, lists without spreads do not even have keys
+enum BR_ARG_KINDS
+{
+    BR_ARG_INDEX               =  0,   // regular argument, the index of a variable
+    BR_ARG_SPREAD              =  1,   // view of every index in a list, e.g. ...var
+    BR_ARG_SPREAD_ARGS         =  2,   // view of every argument in an args list, without the function, e.g. ...%
+};
+
+// returned by br_arg_resolve past the last argument, -1 can not be used, negative indexes are user function arguments
+#define BR_ARG_OUT_OF_RANGE INTPTR_MAX
+
+// BRUTER-REPRESENTATION CONTEXT VARIABLES
+// indexes of the variables created by br_new_context, memory accounting and checkpoints read them here instead of searching by key
+enum BR_CONTEXT
+{
+    BR_CONTEXT_DELIMITER       =  0,
+    BR_CONTEXT_UNUSED          =  1,
+    BR_CONTEXT_PARSER          =  2,
+    BR_CONTEXT_EVALUATOR       =  3,
+    BR_CONTEXT_CONTEXT         =  4,
+    BR_CONTEXT_MEMORY          =  5,
+    BR_CONTEXT_CHECKPOINT      =  6,
+};
+
+// BRUTER-REPRESENTATION MEMORY ACCOUNTING
+// every entry is a slot in the "memory" list of the context, all values are in bytes
+enum BR_MEMORY
+{
+    BR_MEMORY_KEYS             =  0,   // variable keys
+    BR_MEMORY_BUFFERS          =  1,   // buffers, only the ones whose creator attached their size with br_memory_attach
+    BR_MEMORY_LISTS            =  2,   // lists, including the unused, parser and evaluator lists, but not the context itself
+    BR_MEMORY_BAKED            =  3,   // baked code and user functions, including their commands
+    BR_MEMORY_TEMPORARY        =  4,   // parser and splitter temporaries, only non-zero while parsing
+    BR_MEMORY_TOTAL            =  5,   // sum of all the above
+    BR_MEMORY_PEAK             =  6,   // highest total seen so far
+    BR_MEMORY_LIMIT            =  7,   // hard limit for the total, 0 means no limit, br_eval and br_baked_call fail when it is exceeded
+    BR_MEMORY_SLOTS            =  8,   // internal, list with the bytes and category accounted for each variable
+};
+
+// BRUTER-REPRESENTATION CHECKPOINT
+// every entry is a slot in the "checkpoint" list of the context
+enum BR_CHECKPOINT
+{
+    BR_CHECKPOINT_SIZE         =  0,   // context size when the checkpoint was made, -1 if there is no checkpoint
+    BR_CHECKPOINT_UNUSED       =  1,   // unused list size when the checkpoint was made
+    BR_CHECKPOINT_LOG          =  2,   // original value, key and type of every variable written since the checkpoint, the keys are not owned by the log
+    BR_CHECKPOINT_INDEXES      =  3,   // index of the variable of each log entry, its type is 1 if the variable owns its current value
+    BR_CHECKPOINT_STAMPS       =  4,   // log position of each variable, only valid if the log entry points back to it
+    BR_CHECKPOINT_POPPED       =  5,   // position and index of every variable reused from the unused list
+    BR_CHECKPOINT_DEFERRED     =  6,   // original keys and values that would have been freed, they are freed by br_commit
+    BR_CHECKPOINT_SLOTS        =  7,   // bytes and category accounted for the variable of each log entry, buffers can not be measured again
+    BR_CHECKPOINT_ORPHANS      =  8,   // values owned by a variable until br_arg_set replaced them, they are freed by br_rollback
+};
+
 #define BR_INIT(name) void init_##name(BruterList *context)
 #define BR_FUNCTION(name) BruterInt name(BruterList *context, BruterList *args)
 #define BR_PARSER_STEP(name) bool name(BruterList *context, BruterList *parser, BruterList *result, BruterList *splited_command, BruterInt word_index, BruterInt step_index)
@@ -49,24 +117,9 @@ typedef BruterInt (*EvaluatorStep)(BruterList *context, BruterList *parser, Brut
 // bruter spread argument
 #define BR_SPECIAL_RETURN INTPTR_MIN
 
-// receive a context and a list of indexes relative to the context, and call it as a stack
-// the function pointer must have the same type as br_call BruterInt(*)(BruterList*, BruterList*);
-STATIC_INLINE BruterInt     br_call(BruterList *context, BruterList *list);
-
-// contextual call
-STATIC_INLINE BruterInt br_call(BruterList *context, BruterList *list)
-{
-    BruterInt(*func)(BruterList*, BruterList*);
-
-    if (list->size == 0)
-    {
-        printf("BRUTER_ERROR: cannot call an empty list\n");
-        exit(EXIT_FAILURE);
-    }
-
-    func = context->data[list->data[0].i].p;
-    return func(context, list);
-}
+// returned by br_eval, br_evaluate and br_baked_call when the memory limit is exceeded, -1 still means no result
+// functions that run code themselves (loops, ifs, etc) should return it as is when they get it, so it reaches the top
+#define BR_MEMORY_EXCEEDED (INTPTR_MIN + 1)
 
 // regular function declarations
 STATIC_INLINE BruterValue   br_arg_get(const BruterList *context, const BruterList *args, BruterInt arg_index);
@@ -85,9 +138,19 @@ STATIC_INLINE void          br_arg_set_key(BruterList *context, BruterList *args
 STATIC_INLINE void          br_arg_set_type(BruterList *context, BruterList *args, BruterInt arg_index, int8_t type);
 STATIC_INLINE void          br_arg_set_index(BruterList *args, BruterInt arg_index, BruterInt index);
 
+STATIC_INLINE int8_t        br_arg_kind(const BruterList *args, BruterInt position);
+STATIC_INLINE bool          br_arg_has_spreads(const BruterList *args);
+STATIC_INLINE BruterInt     br_arg_spread_length(const BruterList *args, BruterInt position);
+STATIC_INLINE BruterInt     br_arg_length(const BruterList *args);
+STATIC_INLINE BruterInt     br_arg_resolve(const BruterList *args, BruterInt position);
+STATIC_INLINE void          br_arg_push_spread(BruterList *args, BruterList *list, int8_t kind);
+STATIC_INLINE void          br_arg_flatten(BruterList *args);
+
 STATIC_INLINE char*         br_str_duplicate(const char *str);
 STATIC_INLINE char*         br_str_nduplicate(const char *str, size_t size);
 STATIC_INLINE char*         br_str_format(const char *format, ...);
+STATIC_INLINE char*         br_str_append(char *str, const char *suffix);
+STATIC_INLINE char*         br_key_duplicate(const char *key);
 
 STATIC_INLINE BruterList*   br_str_special_space_split(const char *str);
 STATIC_INLINE BruterList*   br_str_split(const char *str, char delim);
@@ -103,11 +166,55 @@ STATIC_INLINE BruterInt     br_eval(BruterList *context, const char *cmd);
 
 STATIC_INLINE BruterInt     br_bake_code(BruterList *context, BruterList* parser, const char *cmd);
 STATIC_INLINE BruterInt     br_baked_call(BruterList *context, BruterList *compiled);
+STATIC_INLINE char*         br_bake_to_c(const BruterList *context, BruterInt index, const char *name);
 
 STATIC_INLINE BruterList*   br_get_parser(const BruterList *context);
 STATIC_INLINE BruterList*   br_get_unused(const BruterList *context);
 STATIC_INLINE BruterList*   br_get_evaluator(const BruterList *context);
 
+STATIC_INLINE BruterInt     br_list_bytes(const BruterList *list);
+STATIC_INLINE BruterInt     br_value_bytes(BruterValue value, int8_t type);
+STATIC_INLINE int8_t        br_memory_category(int8_t type);
+STATIC_INLINE BruterList*   br_memory_list(const BruterList *context);
+
+STATIC_INLINE BruterInt     br_memory_get(const BruterList *context, int8_t category);
+STATIC_INLINE void          br_memory_set_limit(BruterList *context, BruterInt limit);
+STATIC_INLINE bool          br_memory_exceeded(const BruterList *context);
+STATIC_INLINE void          br_memory_track(BruterList *context, int8_t category, BruterInt bytes);
+STATIC_INLINE void          br_memory_attach(BruterList *context, BruterInt index, int8_t category, BruterInt bytes);
+STATIC_INLINE void          br_memory_detach(BruterList *context, BruterInt index);
+STATIC_INLINE void          br_memory_update(BruterList *context);
+STATIC_INLINE void          br_memory_remeasure(BruterList *context, const BruterList *args);
+
+STATIC_INLINE BruterList*   br_get_checkpoint(const BruterList *context);
+STATIC_INLINE BruterList*   br_checkpoint_active(const BruterList *context);
+STATIC_INLINE void          br_checkpoint(BruterList *context);
+STATIC_INLINE void          br_rollback(BruterList *context);
+STATIC_INLINE void          br_commit(BruterList *context);
+STATIC_INLINE void          br_checkpoint_log(BruterList *context, BruterInt index, int8_t owned);
+STATIC_INLINE bool          br_checkpoint_defer(BruterList *context, BruterInt index, void *pointer, int8_t type);
+
+// receive a context and a list of indexes relative to the context, and call it as a stack
+// the function pointer must have the same type as br_call BruterInt(*)(BruterList*, BruterList*);
+STATIC_INLINE BruterInt     br_call(BruterList *context, BruterList *list);
+
+// contextual call
+STATIC_INLINE BruterInt br_call(BruterList *context, BruterList *list)
+{
+    BruterInt(*func)(BruterList*, BruterList*);
+    BruterInt index = (list->size == 0) ? BR_ARG_OUT_OF_RANGE : br_arg_get_index(list, -1);
+
+    // a list with spreads can have entries and still be empty
+    if (index == BR_ARG_OUT_OF_RANGE)
+    {
+        printf("BRUTER_ERROR: cannot call an empty list\n");
+        exit(EXIT_FAILURE);
+    }
+
+    func = context->data[index].p;
+    return func(context, list);
+}
+
 
 // functions definitions
 // functions definitions
@@ -120,79 +227,111 @@ STATIC_INLINE BruterList*   br_get_evaluator(const BruterList *context);
 // arg stuff
 STATIC_INLINE BruterValue br_arg_get(const BruterList *context, const BruterList *args, BruterInt arg_index)
 {
-    return context->data[args->data[arg_index+1].i];
+    return context->data[br_arg_get_index(args, arg_index)];
 }
 
 STATIC_INLINE BruterInt br_arg_get_int(const BruterList *context, const BruterList *args, BruterInt arg_index)
 {
-    return context->data[args->data[arg_index+1].i].i;
+    return context->data[br_arg_get_index(args, arg_index)].i;
 }
 
 STATIC_INLINE BruterUInt br_arg_get_uint(const BruterList *context, const BruterList *args, BruterInt arg_index)
 {
-    return context->data[args->data[arg_index+1].i].u;
+    return context->data[br_arg_get_index(args, arg_index)].u;
 }
 
 STATIC_INLINE BruterFloat br_arg_get_float(const BruterList *context, const BruterList *args, BruterInt arg_index)
 {
-    return context->data[args->data[arg_index+1].i].f;
+    return context->data[br_arg_get_index(args, arg_index)].f;
 }
 
 STATIC_INLINE void* br_arg_get_pointer(const BruterList *context, const BruterList *args, BruterInt arg_index)
 {
-    return context->data[args->data[arg_index+1].i].p;
+    return context->data[br_arg_get_index(args, arg_index)].p;
 }
 
 STATIC_INLINE char* br_arg_get_key(const BruterList *context, const BruterList *args, BruterInt arg_index)
 {
-    return context->keys[args->data[arg_index+1].i];
+    return context->keys[br_arg_get_index(args, arg_index)];
 }
 
 STATIC_INLINE int8_t br_arg_get_type(const BruterList *context, const BruterList *args, BruterInt arg_index)
 {
-    return context->types[args->data[arg_index+1].i];
+    return context->types[br_arg_get_index(args, arg_index)];
 }
 
 STATIC_INLINE BruterInt br_arg_get_index(const BruterList *args, BruterInt arg_index)
 {
-    return args->data[arg_index+1].i;
+    if (args->keys == NULL)
+    {
+        return args->data[arg_index+1].i;
+    }
+
+    return br_arg_resolve(args, arg_index+1);
 }
 
 STATIC_INLINE BruterInt br_arg_get_count(const BruterList *args)
 {
-    return args->size - 1;
+    if (args->keys == NULL)
+    {
+        return args->size - 1;
+    }
+
+    return br_arg_length(args) - 1;
 }
 
 STATIC_INLINE void br_arg_set(BruterList *context, BruterList *args, BruterInt arg_index, BruterValue value)
 {
-    context->data[args->data[arg_index+1].i] = value;
+    BruterInt index = br_arg_get_index(args, arg_index);
+    // the value may be shared with another variable, so br_rollback never frees it
+    br_checkpoint_log(context, index, 0);
+    context->data[index] = value;
 }
 
 STATIC_INLINE void br_arg_set_key(BruterList *context, BruterList *args, BruterInt arg_index, const char *key)
 {
-    if (args->data[arg_index+1].i < 0 || args->data[arg_index+1].i >= context->size)
+    BruterInt index = br_arg_get_index(args, arg_index);
+
+    if (index < 0 || index >= context->size)
     {
-        printf("BR_ERROR: index %" PRIdPTR " out of range in list of size %" PRIdPTR " \n", args->data[arg_index+1].i, context->size);
+        printf("BR_ERROR: index %" PRIdPTR " out of range in list of size %" PRIdPTR " \n", index, context->size);
         exit(EXIT_FAILURE);
     }
     
-    free(context->keys[args->data[arg_index+1].i]);
-    context->keys[args->data[arg_index+1].i] = br_str_duplicate(key);
+    br_checkpoint_log(context, index, -1);
+
+    if (context->keys[index] != NULL)
+    {
+        br_memory_track(context, BR_MEMORY_KEYS, -(BruterInt)(strlen(context->keys[index]) + 1));
+        if (!br_checkpoint_defer(context, index, context->keys[index], BR_TYPE_ANY))
+        {
+            free(context->keys[index]);
+        }
+    }
+
+    context->keys[index] = br_key_duplicate(key);
+    br_memory_track(context, BR_MEMORY_KEYS, (BruterInt)(strlen(key) + 1));
 }
 
 STATIC_INLINE void br_arg_set_type(BruterList *context, BruterList *args, BruterInt arg_index, int8_t type)
 {
-    if (args->data[arg_index+1].i < 0 || args->data[arg_index+1].i >= context->size)
+    BruterInt index = br_arg_get_index(args, arg_index);
+
+    if (index < 0 || index >= context->size)
     {
-        printf("BR_ERROR: index %" PRIdPTR " out of range in list of size %" PRIdPTR " \n", args->data[arg_index+1].i, context->size);
+        printf("BR_ERROR: index %" PRIdPTR " out of range in list of size %" PRIdPTR " \n", index, context->size);
         exit(EXIT_FAILURE);
     }
 
-    context->types[args->data[arg_index+1].i] = type;
+    br_checkpoint_log(context, index, -1);
+    context->types[index] = type;
 }
 
 STATIC_INLINE void br_arg_set_index(BruterList *args, BruterInt arg_index, BruterInt index)
 {
+    // the spreads are views of other lists, so they are copied before anything changes
+    br_arg_flatten(args);
+
     if (index < 0 || index >= args->size)
     {
         printf("BR_ERROR: index %" PRIdPTR " out of range in list of size %" PRIdPTR " \n", index, args->size);
@@ -202,11 +341,183 @@ STATIC_INLINE void br_arg_set_index(BruterList *args, BruterInt arg_index, Brute
     args->data[arg_index+1].i = index;
 }
 
+// spreads
+// an args list with spreads has keys, every spread is a single entry pointing to the list it is a view of,
+// so spreading costs the same no matter the size of the list, the list must not change while the args are in use
+// spreads of lists that have spreads of their own are marked "...+" or "...%+", only those are walked to be resolved
+STATIC_INLINE int8_t br_arg_kind(const BruterList *args, BruterInt position)
+{
+    const char *key = (args->keys == NULL) ? NULL : args->keys[position];
+
+    if (key == NULL || key[0] != '.')
+    {
+        return BR_ARG_INDEX;
+    }
+    else if (strcmp(key, "...") == 0 || strcmp(key, "...+") == 0)
+    {
+        return BR_ARG_SPREAD;
+    }
+    else if (strcmp(key, "...%") == 0 || strcmp(key, "...%+") == 0)
+    {
+        return BR_ARG_SPREAD_ARGS;
+    }
+
+    return BR_ARG_INDEX;
+}
+
+STATIC_INLINE bool br_arg_has_spreads(const BruterList *args)
+{
+    for (BruterInt i = 0; args->keys != NULL && i < args->size; i++)
+    {
+        if (br_arg_kind(args, i) != BR_ARG_INDEX)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// how many arguments the spread at position is a view of
+STATIC_INLINE BruterInt br_arg_spread_length(const BruterList *args, BruterInt position)
+{
+    const BruterList *list = (BruterList*)args->data[position].p;
+    const char *key = args->keys[position];
+    BruterInt length = (key[strlen(key) - 1] == '+') ? br_arg_length(list) : list->size;
+
+    if (br_arg_kind(args, position) == BR_ARG_SPREAD_ARGS)
+    {
+        // an empty args list has no function to skip
+        return (length > 0) ? length - 1 : 0;
+    }
+
+    return length;
+}
+
+STATIC_INLINE BruterInt br_arg_length(const BruterList *args)
+{
+    BruterInt length = 0;
+
+    if (args->keys == NULL)
+    {
+        return args->size;
+    }
+
+    for (BruterInt i = 0; i < args->size; i++)
+    {
+        length += (br_arg_kind(args, i) == BR_ARG_INDEX) ? 1 : br_arg_spread_length(args, i);
+    }
+
+    return length;
+}
+
+// position 0 is the function, returns BR_ARG_OUT_OF_RANGE if the position is out of range
+STATIC_INLINE BruterInt br_arg_resolve(const BruterList *args, BruterInt position)
+{
+    if (position < 0)
+    {
+        return BR_ARG_OUT_OF_RANGE;
+    }
+    else if (args->keys == NULL)
+    {
+        return (position >= args->size) ? BR_ARG_OUT_OF_RANGE : args->data[position].i;
+    }
+
+    for (BruterInt i = 0; i < args->size; i++)
+    {
+        BruterList *list = (BruterList*)args->data[i].p;
+        BruterInt length = 0;
+        BruterInt skip = 0;
+
+        switch (br_arg_kind(args, i))
+        {
+            case BR_ARG_SPREAD_ARGS:
+                skip = 1;
+                // fall through
+            case BR_ARG_SPREAD:
+                length = br_arg_spread_length(args, i);
+                if (position < length)
+                {
+                    const char *key = args->keys[i];
+                    return (key[strlen(key) - 1] == '+') ? br_arg_resolve(list, position + skip) : list->data[position + skip].i;
+                }
+                position -= length;
+                break;
+            default:
+                if (position == 0)
+                {
+                    return args->data[i].i;
+                }
+                position--;
+                break;
+        }
+    }
+
+    return BR_ARG_OUT_OF_RANGE;
+}
+
+// push a view of list into args, used by the spread parser steps instead of pushing every index
+STATIC_INLINE void br_arg_push_spread(BruterList *args, BruterList *list, int8_t kind)
+{
+    bool nested = br_arg_has_spreads(list);
+
+    if (args->keys == NULL)
+    {
+        args->keys = (char**)calloc((size_t)args->capacity, sizeof(char*));
+        if (args->keys == NULL)
+        {
+            printf("BR_ERROR: failed to allocate memory for argument kinds\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (kind == BR_ARG_SPREAD_ARGS)
+    {
+        bruter_push_pointer(args, (void*)list, nested ? "...%+" : "...%", 0);
+    }
+    else
+    {
+        bruter_push_pointer(args, (void*)list, nested ? "...+" : "...", 0);
+    }
+}
+
+// replace every spread with the indexes it is a view of, the keys of the args go away with the spreads
+STATIC_INLINE void br_arg_flatten(BruterList *args)
+{
+    BruterList *flat = NULL;
+
+    if (!br_arg_has_spreads(args))
+    {
+        return;
+    }
+
+    flat = bruter_new(br_arg_length(args), false, false);
+    for (BruterInt i = 0; i < flat->capacity; i++)
+    {
+        bruter_push_int(flat, br_arg_resolve(args, i), NULL, 0);
+    }
+
+    for (BruterInt i = 0; i < args->size; i++)
+    {
+        free(args->keys[i]);
+    }
+    free(args->keys);
+    args->keys = NULL;
+    args->size = 0;
+
+    for (BruterInt i = 0; i < flat->size; i++)
+    {
+        bruter_push_int(args, flat->data[i].i, NULL, 0);
+    }
+
+    bruter_free(flat);
+}
+
 // string stuff
 STATIC_INLINE char* br_str_duplicate(const char *str)
 {
     size_t len = strlen(str);
-    char *dup = (char*)malloc(len + 1);
+    char *dup = (char*)BR_MALLOC(len + 1);
     
     if (dup == NULL)
     {
@@ -220,7 +531,7 @@ STATIC_INLINE char* br_str_duplicate(const char *str)
 
 STATIC_INLINE char* br_str_nduplicate(const char *str, size_t size)
 {
-    char *dup = (char*)malloc(size + 1);
+    char *dup = (char*)BR_MALLOC(size + 1);
     
     if (dup == NULL)
     {
@@ -242,7 +553,7 @@ STATIC_INLINE char* br_str_format(const char *format, ...)
     va_start(args, format);
     size = (size_t)vsnprintf(NULL, 0, format, args);
     va_end(args);
-    str = (char*)malloc(size + 1);
+    str = (char*)BR_MALLOC(size + 1);
     if (str == NULL)
     {
         printf("BR_ERROR: failed to allocate memory for formatted string\n");
@@ -254,6 +565,40 @@ STATIC_INLINE char* br_str_format(const char *format, ...)
     return str;
 }
 
+STATIC_INLINE char* br_key_duplicate(const char *key)
+{
+    size_t len = strlen(key);
+    char *dup = (char*)malloc(len + 1);
+    
+    if (dup == NULL)
+    {
+        printf("BR_ERROR: failed to allocate memory for key duplication\n");
+        exit(EXIT_FAILURE);
+    }
+    
+    memcpy(dup, key, len + 1);
+    return dup;
+}
+
+// appends suffix to str, str is freed and the result must be freed with BR_FREE
+STATIC_INLINE char* br_str_append(char *str, const char *suffix)
+{
+    size_t len = strlen(str);
+    size_t suffix_len = strlen(suffix);
+    char *result = (char*)BR_MALLOC(len + suffix_len + 1);
+
+    if (result == NULL)
+    {
+        printf("BR_ERROR: failed to allocate memory for string append\n");
+        exit(EXIT_FAILURE);
+    }
+
+    memcpy(result, str, len);
+    memcpy(result + len, suffix, suffix_len + 1);
+    BR_FREE(str);
+    return result;
+}
+
 STATIC_INLINE BruterList* br_str_special_space_split(const char *str)
 {
     BruterList *splited = bruter_new(sizeof(void*), false, false);
@@ -400,23 +745,45 @@ STATIC_INLINE BruterList* br_str_split(const char *str, char delim)
 STATIC_INLINE BruterInt br_new_var(BruterList *context, BruterValue value, const char* key, int8_t type)
 {
     BruterList *unused = br_get_unused(context);
+    BruterInt index = -1;
     if (unused->size > 0)
     {
         // reuse an unused variable
-        BruterInt _value = bruter_pop_int(unused);
-        if (key != NULL)
+        index = bruter_pop_int(unused);
+
+        BruterList *checkpoint = br_checkpoint_active(context);
+        if (checkpoint != NULL)
         {
-            context->keys[_value] = br_str_duplicate(key);
+            // remember where it was, so br_rollback can put it back
+            BruterList *popped = (BruterList*)checkpoint->data[BR_CHECKPOINT_POPPED].p;
+            bruter_push_int(popped, unused->size, NULL, 0);
+            bruter_push_int(popped, index, NULL, 0);
         }
-        context->data[_value] = value;
-        context->types[_value] = type;
-        return _value;
+
+        // the value is new, so br_rollback frees it just like the variables created after the checkpoint
+        br_checkpoint_log(context, index, 1);
+        context->data[index] = value;
+        context->types[index] = type;
     }
     else
     {
-        bruter_push(context, value, key, type);
-        return context->size-1;
+        bruter_push(context, value, NULL, type);
+        index = context->size-1;
     }
+
+    if (key != NULL)
+    {
+        context->keys[index] = br_key_duplicate(key);
+        br_memory_track(context, BR_MEMORY_KEYS, (BruterInt)(strlen(key) + 1));
+    }
+
+    // buffer sizes are unknown here, their creator can attach them
+    if (br_memory_category(type) != -1 && type != BR_TYPE_BUFFER)
+    {
+        br_memory_attach(context, index, br_memory_category(type), br_value_bytes(value, type));
+    }
+
+    return index;
 }
 
 // just clears the variable and key at the specified index
@@ -428,25 +795,33 @@ STATIC_INLINE void br_clear_var(BruterList *context, BruterInt index)
         return;
     }
     
+    br_checkpoint_log(context, index, -1);
+
     // free the key if it exists
     if (context->keys[index] != NULL)
     {
-        free(context->keys[index]);
+        br_memory_track(context, BR_MEMORY_KEYS, -(BruterInt)(strlen(context->keys[index]) + 1));
+        if (!br_checkpoint_defer(context, index, context->keys[index], BR_TYPE_ANY))
+        {
+            free(context->keys[index]);
+        }
         context->keys[index] = NULL;
     }
 
+    br_memory_detach(context, index);
+
     switch (context->types[index])
     {
         case BR_TYPE_BUFFER:
             // free the buffer if it exists
-            if (context->data[index].p != NULL)
+            if (context->data[index].p != NULL && !br_checkpoint_defer(context, index, context->data[index].p, BR_TYPE_BUFFER))
             {
-                free(context->data[index].p);
+                BR_FREE(context->data[index].p);
             }
             break;
         case BR_TYPE_LIST:
             // free the list if it exists
-            if (context->data[index].p != NULL)
+            if (context->data[index].p != NULL && !br_checkpoint_defer(context, index, context->data[index].p, BR_TYPE_LIST))
             {
                 bruter_free((BruterList*)context->data[index].p);
             }
@@ -466,9 +841,13 @@ STATIC_INLINE BruterList* br_parse(BruterList *context, BruterList* parser, cons
     BruterList *result = bruter_new(sizeof(void*), false, false);
     
     BruterList *splited = br_str_special_space_split(cmd);
+    // the words are never longer than the command, plus one terminator each
+    BruterInt temporary = br_list_bytes(splited) + (BruterInt)strlen(cmd) + splited->size;
     char* str = NULL;
     BruterInt i = 0;
 
+    br_memory_track(context, BR_MEMORY_TEMPORARY, temporary);
+
     for (i = 0; i < splited->size; i++)
     {
         str = (char*)splited->data[i].p;
@@ -484,10 +863,11 @@ STATIC_INLINE BruterList* br_parse(BruterList *context, BruterList* parser, cons
             }
         }
 
-        free(str);
+        BR_FREE(str);
     }
 
     bruter_free(splited);
+    br_memory_track(context, BR_MEMORY_TEMPORARY, -temporary);
     return result;
 }
 
@@ -508,16 +888,20 @@ STATIC_INLINE BruterInt br_bake_code(BruterList *context, BruterList *parser, co
     {
         BruterList *args = br_parse(context, parser, str = (char*)splited->data[i].p);
         BruterInt args_index = -1;
+
+        // baked code outlives the lists it spreads, so it keeps their content at bake time, just like before spreads were views
+        br_arg_flatten(args);
         if (args->size == 0)
         {
             printf("BR_WARNING: empty command in baked code\n");
             bruter_free(args);
-            free(str);
+            BR_FREE(str);
             continue; // skip empty commands
         }
         args_index = br_new_var(context, (BruterValue){.p=(void*)args}, NULL, BR_TYPE_LIST); // store the args in the context
+        br_memory_attach(context, args_index, BR_MEMORY_BAKED, br_list_bytes(args)); // the commands are part of the baked code
         bruter_push(compiled, (BruterValue){.i = args_index}, NULL, 0);
-        free(str);
+        BR_FREE(str);
     }
     bruter_free(splited);
     result = br_new_var(context, (BruterValue){.p=compiled}, NULL, BR_TYPE_BAKED);
@@ -530,7 +914,15 @@ STATIC_INLINE BruterInt br_baked_call(BruterList *context, BruterList *compiled)
     for (BruterInt i = 0; i < compiled->size; i++)
     {
         BruterList *args = (BruterList*)context->data[compiled->data[i].i].p;
+
+        if (br_memory_exceeded(context))
+        {
+            printf("BR_ERROR: memory limit of %" PRIdPTR " bytes exceeded, %" PRIdPTR " bytes in use\n", br_memory_get(context, BR_MEMORY_LIMIT), br_memory_get(context, BR_MEMORY_TOTAL));
+            return BR_MEMORY_EXCEEDED;
+        }
+
         result = br_call(context, args);
+        br_memory_remeasure(context, args);
         if (result != -1)
         {
             break;
@@ -539,6 +931,132 @@ STATIC_INLINE BruterInt br_baked_call(BruterList *context, BruterList *compiled)
     return result;
 }
 
+// translate baked code or a user function into C that defines BR_FUNCTION(name) and BR_INIT(name), see the changelog for the details
+// the result must be freed with BR_FREE, it returns NULL if name is not a valid C identifier
+STATIC_INLINE char* br_bake_to_c(const BruterList *context, BruterInt index, const char *name)
+{
+    BruterList *compiled = NULL;
+    char *code = NULL;
+    char *line = NULL;
+
+    if (index < 0 || index >= context->size)
+    {
+        printf("BR_ERROR: index %" PRIdPTR " out of range in list of size %" PRIdPTR " \n", index, context->size);
+        return NULL;
+    }
+
+    if (context->types[index] != BR_TYPE_BAKED && context->types[index] != BR_TYPE_USER_FUNCTION)
+    {
+        printf("BR_ERROR: cannot translate variable of type %d to C, only baked code and user functions can be translated\n", context->types[index]);
+        return NULL;
+    }
+
+    if (name == NULL || !(isalpha((unsigned char)name[0]) || name[0] == '_'))
+    {
+        printf("BR_ERROR: invalid C function name \"%s\"\n", name == NULL ? "" : name);
+        return NULL;
+    }
+
+    for (size_t i = 1; name[i] != '\0'; i++)
+    {
+        if (!(isalnum((unsigned char)name[i]) || name[i] == '_'))
+        {
+            printf("BR_ERROR: invalid C function name \"%s\"\n", name);
+            return NULL;
+        }
+    }
+
+    compiled = (BruterList*)context->data[index].p;
+    code = br_str_format("#include <bruter-representation.h>\n\nBR_FUNCTION(%s)\n{\n    BruterInt result = -1;\n    (void)args;\n", name);
+
+    for (BruterInt i = 0; i < compiled->size; i++)
+    {
+        BruterList *command = (BruterList*)context->data[compiled->data[i].i].p;
+        BruterInt size = br_arg_length(command); // positions below it are in range, so negative indexes are always arguments
+        bool uses_args = false;
+
+        if (size == 0)
+        {
+            continue; // br_call would fail on it anyway
+        }
+
+        for (BruterInt j = 0; j < size; j++)
+        {
+            if (br_arg_resolve(command, j) < 0)
+            {
+                uses_args = true;
+                break;
+            }
+        }
+
+        // the same limit check br_baked_call does before each command
+        code = br_str_append(code, "\n    if (br_memory_exceeded(context))\n"
+                                   "    {\n"
+                                   "        printf(\"BR_ERROR: memory limit of %\" PRIdPTR \" bytes exceeded, %\" PRIdPTR \" bytes in use\\n\", br_memory_get(context, BR_MEMORY_LIMIT), br_memory_get(context, BR_MEMORY_TOTAL));\n"
+                                   "        return BR_MEMORY_EXCEEDED;\n"
+                                   "    }\n");
+
+        if (!uses_args)
+        {
+            line = br_str_format("    result = ((BruterInt(*)(BruterList*, BruterList*))context->data[%" PRIdPTR "].p)(context, (BruterList*)context->data[%" PRIdPTR "].p);\n"
+                                 "    br_memory_remeasure(context, (BruterList*)context->data[%" PRIdPTR "].p);\n"
+                                 "    if (result != -1)\n"
+                                 "    {\n"
+                                 "        return result;\n"
+                                 "    }\n", br_arg_resolve(command, 0), compiled->data[i].i, compiled->data[i].i);
+            code = br_str_append(code, line);
+            BR_FREE(line);
+            continue;
+        }
+
+        // spreads are resolved now, so the copy has their current content
+        line = br_str_format("    {\n        BruterList *command = bruter_new(%" PRIdPTR ", false, false);\n", size);
+        code = br_str_append(code, line);
+        BR_FREE(line);
+
+        for (BruterInt j = 0; j < size; j++)
+        {
+            if (br_arg_resolve(command, j) < 0)
+            {
+                line = br_str_format("        bruter_push_int(command, br_arg_get_index(args, %" PRIdPTR "), NULL, 0);\n", -br_arg_resolve(command, j) - 1);
+            }
+            else
+            {
+                line = br_str_format("        bruter_push_int(command, %" PRIdPTR ", NULL, 0);\n", br_arg_resolve(command, j));
+            }
+            code = br_str_append(code, line);
+            BR_FREE(line);
+        }
+
+        if (br_arg_resolve(command, 0) < 0)
+        {
+            code = br_str_append(code, "        result = ((BruterInt(*)(BruterList*, BruterList*))context->data[command->data[0].i].p)(context, command);\n");
+        }
+        else
+        {
+            line = br_str_format("        result = ((BruterInt(*)(BruterList*, BruterList*))context->data[%" PRIdPTR "].p)(context, command);\n", br_arg_resolve(command, 0));
+            code = br_str_append(code, line);
+            BR_FREE(line);
+        }
+
+        code = br_str_append(code, "        br_memory_remeasure(context, command);\n"
+                                   "        bruter_free(command);\n"
+                                   "        if (result != -1)\n"
+                                   "        {\n"
+                                   "            return result;\n"
+                                   "        }\n"
+                                   "    }\n");
+    }
+
+    line = br_str_format("\n    return result;\n}\n\n"
+                         "BR_INIT(%s)\n{\n"
+                         "    br_new_var(context, (BruterValue){.p = (void*)%s}, \"%s\", BR_TYPE_FUNCTION);\n"
+                         "}\n", name, name, name);
+    code = br_str_append(code, line);
+    BR_FREE(line);
+    return code;
+}
+
 STATIC_INLINE BruterList *br_new_context(BruterInt initial_size)
 {
     // it will grow as needed
@@ -564,17 +1082,65 @@ STATIC_INLINE BruterList *br_new_context(BruterInt initial_size)
     // note context is not typed as a list, but as a int, because it is a pointer to itself
     bruter_push_pointer(context, (void*)context, "context", BR_TYPE_NULL);
 
+    // lets push the memory accounting list to the context
+    // every counter is keyed, so scripts can read them by name, the last entry is the per-variable accounting
+    BruterList *memory = bruter_new(BR_MEMORY_SLOTS + 1, true, false);
+    bruter_push_int(memory, 0, "keys", 0);
+    bruter_push_int(memory, 0, "buffers", 0);
+    bruter_push_int(memory, 0, "lists", 0);
+    bruter_push_int(memory, 0, "baked", 0);
+    bruter_push_int(memory, 0, "temporary", 0);
+    bruter_push_int(memory, 0, "total", 0);
+    bruter_push_int(memory, 0, "peak", 0);
+    bruter_push_int(memory, 0, "limit", 0);
+    bruter_push_pointer(memory, (void*)bruter_new(initial_size, false, true), "slots", 0);
+    bruter_push_pointer(context, (void*)memory, "memory", BR_TYPE_LIST);
+
+    // lets push the checkpoint list to the context, there is no checkpoint until br_checkpoint is called
+    BruterList *checkpoint = bruter_new(BR_CHECKPOINT_ORPHANS + 1, true, false);
+    bruter_push_int(checkpoint, -1, "size", 0);
+    bruter_push_int(checkpoint, 0, "unused", 0);
+    bruter_push_pointer(checkpoint, (void*)bruter_new(sizeof(void*), true, true), "log", 0);
+    bruter_push_pointer(checkpoint, (void*)bruter_new(sizeof(void*), false, true), "indexes", 0);
+    bruter_push_pointer(checkpoint, (void*)bruter_new(sizeof(void*), false, false), "stamps", 0);
+    bruter_push_pointer(checkpoint, (void*)bruter_new(sizeof(void*), false, false), "popped", 0);
+    bruter_push_pointer(checkpoint, (void*)bruter_new(sizeof(void*), false, true), "deferred", 0);
+    bruter_push_pointer(checkpoint, (void*)bruter_new(sizeof(void*), false, true), "slots", 0);
+    bruter_push_pointer(checkpoint, (void*)bruter_new(sizeof(void*), false, true), "orphans", 0);
+    bruter_push_pointer(context, (void*)checkpoint, "checkpoint", BR_TYPE_LIST);
+
+    // account for everything we just created
+    br_memory_update(context);
+
     return context;
 }
 
 STATIC_INLINE void br_free_context(BruterList *context)
 {
+    BruterList *memory = br_memory_list(context);
+    if (memory != NULL)
+    {
+        // the per-variable accounting list is not a variable, so we free it manually
+        bruter_free((BruterList*)memory->data[BR_MEMORY_SLOTS].p);
+    }
+
+    if (context->size > BR_CONTEXT_CHECKPOINT && context->types[BR_CONTEXT_CHECKPOINT] == BR_TYPE_LIST)
+    {
+        // keep whatever was done since the checkpoint, then free the checkpoint lists
+        BruterList *checkpoint = (BruterList*)context->data[BR_CONTEXT_CHECKPOINT].p;
+        br_commit(context);
+        for (BruterInt i = BR_CHECKPOINT_LOG; i <= BR_CHECKPOINT_ORPHANS; i++)
+        {
+            bruter_free((BruterList*)checkpoint->data[i].p);
+        }
+    }
+
     for (BruterInt i = 0; i < context->size; i++)
     {
         switch (context->types[i])
         {
             case BR_TYPE_BUFFER:
-                free(context->data[i].p);
+                BR_FREE(context->data[i].p);
                 break;
             case BR_TYPE_USER_FUNCTION:
             case BR_TYPE_BAKED:
@@ -608,6 +1174,11 @@ STATIC_INLINE BruterInt br_evaluate(BruterList *context, BruterList *parser, Bru
             // it is used to indicate that the evaluation should stop because its already done
             return -1;
         }
+        else if (result == BR_MEMORY_EXCEEDED)
+        {
+            // the function ran out of memory, the caller must know it
+            return result;
+        }
     }
 
     printf("BR_ERROR: no evaluator step found for the type: %d\n", br_arg_get_type(context, args, -1));
@@ -631,6 +1202,8 @@ STATIC_INLINE BruterInt br_eval(BruterList *context, const char *cmd)
     }
 
     BruterList *splited = br_str_split(cmd, delimiter);
+    // the commands are never longer than cmd, plus one terminator each
+    BruterInt temporary = br_list_bytes(splited) + (BruterInt)strlen(cmd) + splited->size;
     char* str = NULL;
     BruterInt result = -1;
 
@@ -640,32 +1213,49 @@ STATIC_INLINE BruterInt br_eval(BruterList *context, const char *cmd)
         return -1;
     }
 
+    br_memory_track(context, BR_MEMORY_TEMPORARY, temporary);
+
     for (BruterInt i = 0; i < splited->size; i++)
     {
+        if (br_memory_exceeded(context))
+        {
+            // fail this eval only, the context is still usable after freeing something
+            printf("BR_ERROR: memory limit of %" PRIdPTR " bytes exceeded, %" PRIdPTR " bytes in use\n", br_memory_get(context, BR_MEMORY_LIMIT), br_memory_get(context, BR_MEMORY_TOTAL));
+            for (BruterInt j = i; j < splited->size; j++)
+            {
+                BR_FREE(splited->data[j].p);
+            }
+            result = BR_MEMORY_EXCEEDED;
+            break;
+        }
+
         BruterList *args = br_parse(context, parser, str = (char*)splited->data[i].p);
-        if (args->size == 0 || args->data[0].i == -1 || bruter_get_pointer(context, args->data[0].i) == NULL)
+        BruterInt function = (args->size == 0) ? BR_ARG_OUT_OF_RANGE : br_arg_get_index(args, -1);
+        if (function == -1 || function == BR_ARG_OUT_OF_RANGE || bruter_get_pointer(context, function) == NULL)
         {
             //printf("BR_ERROR: empty command or invalid function\n");
-            free(str);
+            BR_FREE(str);
             bruter_free(args);
             continue;
         }
 
         result = br_evaluate(context, parser, args);
+        br_memory_remeasure(context, args);
 
-        free(str);
+        BR_FREE(str);
         bruter_free(args);
 
-        if (result >= 0)
+        if (result >= 0 || result == BR_MEMORY_EXCEEDED)
         {
             for (BruterInt j = i + 1; j < splited->size; j++)
             {
-                free(splited->data[j].p);
+                BR_FREE(splited->data[j].p);
             }
             break;
         }
     }
     bruter_free(splited);
+    br_memory_track(context, BR_MEMORY_TEMPORARY, -temporary);
     return result;
 }
 
@@ -702,6 +1292,544 @@ STATIC_INLINE BruterList *br_get_evaluator(const BruterList *context)
     return (BruterList*)context->data[eval_index].p;
 }
 
+// memory accounting
+// sizes are estimates of what bruter and bruter-representation allocate, they do not include the allocator overhead
+STATIC_INLINE BruterInt br_list_bytes(const BruterList *list)
+{
+    BruterInt bytes = 0;
+
+    if (list == NULL)
+    {
+        return 0;
+    }
+
+    bytes = (BruterInt)sizeof(BruterList) + list->capacity * (BruterInt)sizeof(BruterValue);
+    
+    if (list->keys != NULL)
+    {
+        bytes += list->capacity * (BruterInt)sizeof(char*);
+    }
+
+    if (list->types != NULL)
+    {
+        bytes += list->capacity * (BruterInt)sizeof(int8_t);
+    }
+
+    return bytes;
+}
+
+// the category a variable of the given type is accounted in, -1 if it does not own memory
+STATIC_INLINE int8_t br_memory_category(int8_t type)
+{
+    switch (type)
+    {
+        case BR_TYPE_BUFFER:
+            return BR_MEMORY_BUFFERS;
+        case BR_TYPE_LIST:
+            return BR_MEMORY_LISTS;
+        case BR_TYPE_BAKED:
+        case BR_TYPE_USER_FUNCTION:
+            return BR_MEMORY_BAKED;
+        default:
+            return -1;
+    }
+}
+
+// buffers are not measured, they can hold anything, so only their creator knows their size
+STATIC_INLINE BruterInt br_value_bytes(BruterValue value, int8_t type)
+{
+    switch (type)
+    {
+        case BR_TYPE_LIST:
+        case BR_TYPE_BAKED:
+        case BR_TYPE_USER_FUNCTION:
+            return br_list_bytes((BruterList*)value.p);
+        default:
+            return 0;
+    }
+}
+
+// 0 if the context has no memory list
+STATIC_INLINE BruterInt br_memory_get(const BruterList *context, int8_t category)
+{
+    BruterList *memory = br_memory_list(context);
+    return (memory == NULL) ? 0 : memory->data[category].i;
+}
+
+STATIC_INLINE void br_memory_set_limit(BruterList *context, BruterInt limit)
+{
+    BruterList *memory = br_memory_list(context);
+    if (memory == NULL)
+    {
+        printf("BR_ERROR: cannot set a memory limit in a context without a memory list\n");
+        return;
+    }
+    memory->data[BR_MEMORY_LIMIT].i = limit;
+}
+
+// NULL if the context has no memory list
+STATIC_INLINE BruterList *br_memory_list(const BruterList *context)
+{
+    if (context->size <= BR_CONTEXT_MEMORY || context->types[BR_CONTEXT_MEMORY] != BR_TYPE_LIST)
+    {
+        return NULL;
+    }
+
+    return (BruterList*)context->data[BR_CONTEXT_MEMORY].p;
+}
+
+STATIC_INLINE bool br_memory_exceeded(const BruterList *context)
+{
+    BruterList *memory = br_memory_list(context);
+
+    if (memory == NULL)
+    {
+        return false;
+    }
+
+    return memory->data[BR_MEMORY_LIMIT].i > 0 && memory->data[BR_MEMORY_TOTAL].i > memory->data[BR_MEMORY_LIMIT].i;
+}
+
+// contexts without a memory list are simply not accounted
+STATIC_INLINE void br_memory_track(BruterList *context, int8_t category, BruterInt bytes)
+{
+    BruterList *memory = br_memory_list(context);
+
+    if (memory == NULL)
+    {
+        return;
+    }
+
+    memory->data[category].i += bytes;
+    memory->data[BR_MEMORY_TOTAL].i += bytes;
+
+    if (memory->data[BR_MEMORY_TOTAL].i > memory->data[BR_MEMORY_PEAK].i)
+    {
+        memory->data[BR_MEMORY_PEAK].i = memory->data[BR_MEMORY_TOTAL].i;
+    }
+}
+
+// account bytes to the variable at index, replacing whatever was accounted to it before
+STATIC_INLINE void br_memory_attach(BruterList *context, BruterInt index, int8_t category, BruterInt bytes)
+{
+    BruterList *memory = br_memory_list(context);
+    BruterList *slots = NULL;
+
+    if (memory == NULL)
+    {
+        return;
+    }
+
+    br_memory_detach(context, index);
+
+    slots = (BruterList*)memory->data[BR_MEMORY_SLOTS].p;
+    while (slots->size <= index)
+    {
+        bruter_push_int(slots, 0, NULL, 0);
+    }
+
+    slots->data[index].i = bytes;
+    slots->types[index] = category;
+    br_memory_track(context, category, bytes);
+}
+
+STATIC_INLINE void br_memory_detach(BruterList *context, BruterInt index)
+{
+    BruterList *memory = br_memory_list(context);
+    BruterList *slots = NULL;
+
+    if (memory == NULL)
+    {
+        return;
+    }
+
+    slots = (BruterList*)memory->data[BR_MEMORY_SLOTS].p;
+    if (index < slots->size && slots->data[index].i != 0)
+    {
+        br_memory_track(context, slots->types[index], -slots->data[index].i);
+        slots->data[index].i = 0;
+    }
+}
+
+// checkpoint
+STATIC_INLINE BruterList *br_get_checkpoint(const BruterList *context)
+{
+    if (context->size <= BR_CONTEXT_CHECKPOINT || context->types[BR_CONTEXT_CHECKPOINT] != BR_TYPE_LIST)
+    {
+        printf("BR_ERROR: failed to find checkpoint variable\n");
+        exit(EXIT_FAILURE);
+    }
+    return (BruterList*)context->data[BR_CONTEXT_CHECKPOINT].p;
+}
+
+// the checkpoint list if there is a checkpoint, NULL otherwise, it is called on every write so it only compares integers
+STATIC_INLINE BruterList *br_checkpoint_active(const BruterList *context)
+{
+    BruterList *checkpoint = NULL;
+
+    if (context->size <= BR_CONTEXT_CHECKPOINT || context->types[BR_CONTEXT_CHECKPOINT] != BR_TYPE_LIST)
+    {
+        return NULL;
+    }
+
+    checkpoint = (BruterList*)context->data[BR_CONTEXT_CHECKPOINT].p;
+    return checkpoint->data[BR_CHECKPOINT_SIZE].i == -1 ? NULL : checkpoint;
+}
+
+// start recording every write made through br_new_var, br_arg_set*, and br_clear_var
+// if there is already a checkpoint, everything done since it is kept, just like br_commit
+STATIC_INLINE void br_checkpoint(BruterList *context)
+{
+    BruterList *checkpoint = br_get_checkpoint(context);
+
+    br_commit(context);
+    checkpoint->data[BR_CHECKPOINT_SIZE].i = context->size;
+    checkpoint->data[BR_CHECKPOINT_UNUSED].i = br_get_unused(context)->size;
+}
+
+// undo every write made since the checkpoint and free every variable created after it, the checkpoint stays active
+// it only costs as much as what was done since the checkpoint, changes made inside lists are not undone
+STATIC_INLINE void br_rollback(BruterList *context)
+{
+    BruterList *checkpoint = br_get_checkpoint(context);
+    BruterList *log = (BruterList*)checkpoint->data[BR_CHECKPOINT_LOG].p;
+    BruterList *indexes = (BruterList*)checkpoint->data[BR_CHECKPOINT_INDEXES].p;
+    BruterList *popped = (BruterList*)checkpoint->data[BR_CHECKPOINT_POPPED].p;
+    BruterList *deferred = (BruterList*)checkpoint->data[BR_CHECKPOINT_DEFERRED].p;
+    BruterList *slots = (BruterList*)checkpoint->data[BR_CHECKPOINT_SLOTS].p;
+    BruterList *orphans = (BruterList*)checkpoint->data[BR_CHECKPOINT_ORPHANS].p;
+    BruterList *unused = br_get_unused(context);
+    BruterInt size = checkpoint->data[BR_CHECKPOINT_SIZE].i;
+    BruterInt unused_size = checkpoint->data[BR_CHECKPOINT_UNUSED].i;
+
+    if (size == -1)
+    {
+        printf("BR_ERROR: cannot rollback without a checkpoint\n");
+        return;
+    }
+
+    // free the variables created since the checkpoint
+    for (BruterInt i = context->size - 1; i >= size; i--)
+    {
+        if (context->types[i] == BR_TYPE_BAKED || context->types[i] == BR_TYPE_USER_FUNCTION)
+        {
+            // br_clear_var does not free baked code
+            bruter_free((BruterList*)context->data[i].p);
+            context->types[i] = BR_TYPE_NULL;
+        }
+        br_clear_var(context, i);
+    }
+    context->size = size;
+
+    // restore the variables that existed at the checkpoint
+    for (BruterInt i = log->size - 1; i >= 0; i--)
+    {
+        BruterInt index = indexes->data[i].i;
+
+        if (context->keys[index] != log->keys[i])
+        {
+            if (context->keys[index] != NULL)
+            {
+                br_memory_track(context, BR_MEMORY_KEYS, -(BruterInt)(strlen(context->keys[index]) + 1));
+                free(context->keys[index]);
+            }
+
+            if (log->keys[i] != NULL)
+            {
+                br_memory_track(context, BR_MEMORY_KEYS, (BruterInt)(strlen(log->keys[i]) + 1));
+            }
+        }
+
+        // only values given to the variable by br_new_var since the checkpoint are freed, the others may be shared
+        if (indexes->types[i] == 1 && context->data[index].p != NULL && context->data[index].p != log->data[i].p)
+        {
+            switch (context->types[index])
+            {
+                case BR_TYPE_BUFFER:
+                    BR_FREE(context->data[index].p);
+                    break;
+                case BR_TYPE_LIST:
+                case BR_TYPE_BAKED:
+                case BR_TYPE_USER_FUNCTION:
+                    bruter_free((BruterList*)context->data[index].p);
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        context->data[index] = log->data[i];
+        context->keys[index] = log->keys[i];
+        context->types[index] = log->types[i];
+        log->keys[i] = NULL;
+
+        // put back what was accounted for the variable, measuring again would lose the buffer sizes
+        if (slots->data[i].i == 0)
+        {
+            br_memory_detach(context, index);
+        }
+        else
+        {
+            br_memory_attach(context, index, slots->types[i], slots->data[i].i);
+        }
+    }
+
+    // the values created since the checkpoint that no variable owns anymore
+    for (BruterInt i = 0; i < orphans->size; i++)
+    {
+        switch (orphans->types[i])
+        {
+            case BR_TYPE_BUFFER:
+                BR_FREE(orphans->data[i].p);
+                break;
+            default:
+                bruter_free((BruterList*)orphans->data[i].p);
+                break;
+        }
+    }
+
+    // put the reused variables back in the unused list, in reverse order so each one lands where it was
+    for (BruterInt i = popped->size - 2; i >= 0; i -= 2)
+    {
+        if (popped->data[i].i < unused_size)
+        {
+            while (unused->size <= popped->data[i].i)
+            {
+                bruter_push_int(unused, -1, NULL, 0);
+            }
+            unused->data[popped->data[i].i].i = popped->data[i + 1].i;
+        }
+    }
+
+    while (unused->size < unused_size)
+    {
+        bruter_push_int(unused, -1, NULL, 0);
+    }
+    unused->size = unused_size;
+
+    // the deferred keys and values are back in their variables
+    log->size = 0;
+    indexes->size = 0;
+    popped->size = 0;
+    deferred->size = 0;
+    slots->size = 0;
+    orphans->size = 0;
+}
+
+// keep everything done since the checkpoint and stop recording
+STATIC_INLINE void br_commit(BruterList *context)
+{
+    BruterList *checkpoint = br_get_checkpoint(context);
+    BruterList *log = (BruterList*)checkpoint->data[BR_CHECKPOINT_LOG].p;
+    BruterList *deferred = (BruterList*)checkpoint->data[BR_CHECKPOINT_DEFERRED].p;
+
+    for (BruterInt i = 0; i < deferred->size; i++)
+    {
+        switch (deferred->types[i])
+        {
+            case BR_TYPE_LIST:
+                bruter_free((BruterList*)deferred->data[i].p);
+                break;
+            case BR_TYPE_BUFFER:
+                BR_FREE(deferred->data[i].p);
+                break;
+            default:
+                free(deferred->data[i].p); // keys
+                break;
+        }
+    }
+
+    for (BruterInt i = 0; i < log->size; i++)
+    {
+        log->keys[i] = NULL;
+    }
+
+    log->size = 0;
+    ((BruterList*)checkpoint->data[BR_CHECKPOINT_INDEXES].p)->size = 0;
+    ((BruterList*)checkpoint->data[BR_CHECKPOINT_POPPED].p)->size = 0;
+    ((BruterList*)checkpoint->data[BR_CHECKPOINT_SLOTS].p)->size = 0;
+    ((BruterList*)checkpoint->data[BR_CHECKPOINT_ORPHANS].p)->size = 0; // they belong to whoever took them
+    deferred->size = 0;
+    checkpoint->data[BR_CHECKPOINT_SIZE].i = -1;
+}
+
+// save the original value, key and type of the variable, only the first write since the checkpoint is recorded
+// owned tells if the variable owns the value it is about to get, 1 or 0, or -1 to keep what was recorded
+STATIC_INLINE void br_checkpoint_log(BruterList *context, BruterInt index, int8_t owned)
+{
+    BruterList *checkpoint = br_checkpoint_active(context);
+    BruterList *indexes = NULL;
+    BruterList *stamps = NULL;
+    BruterList *log = NULL;
+    BruterList *slots = NULL;
+    BruterList *orphans = NULL;
+    BruterList *memory = NULL;
+    BruterList *memory_slots = NULL;
+
+    // variables created after the checkpoint are simply freed by br_rollback
+    if (checkpoint == NULL || index < 0 || index >= checkpoint->data[BR_CHECKPOINT_SIZE].i)
+    {
+        return;
+    }
+
+    log = (BruterList*)checkpoint->data[BR_CHECKPOINT_LOG].p;
+    indexes = (BruterList*)checkpoint->data[BR_CHECKPOINT_INDEXES].p;
+    stamps = (BruterList*)checkpoint->data[BR_CHECKPOINT_STAMPS].p;
+    slots = (BruterList*)checkpoint->data[BR_CHECKPOINT_SLOTS].p;
+    orphans = (BruterList*)checkpoint->data[BR_CHECKPOINT_ORPHANS].p;
+    memory = br_memory_list(context);
+    memory_slots = (memory == NULL) ? NULL : (BruterList*)memory->data[BR_MEMORY_SLOTS].p;
+
+    // stamps are never cleared, a stamp is only valid if its log entry points back to the variable
+    if (!(index < stamps->size && stamps->data[index].i < indexes->size && indexes->data[stamps->data[index].i].i == index))
+    {
+        while (stamps->size <= index)
+        {
+            bruter_push_int(stamps, 0, NULL, 0);
+        }
+
+        stamps->data[index].i = indexes->size;
+        bruter_push_int(indexes, index, NULL, 0);
+        bruter_push(log, context->data[index], NULL, context->types[index]);
+        log->keys[log->size - 1] = context->keys[index];
+
+        if (memory_slots != NULL && index < memory_slots->size)
+        {
+            bruter_push_int(slots, memory_slots->data[index].i, NULL, memory_slots->types[index]);
+        }
+        else
+        {
+            bruter_push_int(slots, 0, NULL, 0);
+        }
+    }
+
+    // the value the variable owned is being replaced, br_rollback must still free it
+    if (owned == 0 && indexes->types[stamps->data[index].i] == 1 && context->data[index].p != NULL && br_memory_category(context->types[index]) != -1)
+    {
+        bruter_push(orphans, context->data[index], NULL, context->types[index]);
+    }
+
+    if (owned != -1)
+    {
+        indexes->types[stamps->data[index].i] = owned;
+    }
+}
+
+// if pointer is the original key or value of the variable, keep it alive until br_commit and return true
+STATIC_INLINE bool br_checkpoint_defer(BruterList *context, BruterInt index, void *pointer, int8_t type)
+{
+    BruterList *checkpoint = br_checkpoint_active(context);
+    BruterList *log = NULL;
+    BruterList *stamps = NULL;
+    BruterInt position = -1;
+
+    if (checkpoint == NULL || index < 0 || index >= checkpoint->data[BR_CHECKPOINT_SIZE].i)
+    {
+        return false;
+    }
+
+    log = (BruterList*)checkpoint->data[BR_CHECKPOINT_LOG].p;
+    stamps = (BruterList*)checkpoint->data[BR_CHECKPOINT_STAMPS].p;
+    position = stamps->data[index].i; // br_checkpoint_log was called before any free, so the stamp is valid
+
+    if (log->keys[position] != pointer && log->data[position].p != pointer)
+    {
+        return false;
+    }
+
+    bruter_push_pointer((BruterList*)checkpoint->data[BR_CHECKPOINT_DEFERRED].p, pointer, NULL, type);
+    return true;
+}
+
+// measure every variable again, lists grow after being created, so the counters drift until this is called
+// buffers keep whatever their creator attached to them
+STATIC_INLINE void br_memory_update(BruterList *context)
+{
+    BruterList *memory = br_memory_list(context);
+    BruterList *slots = NULL;
+    BruterInt keys = 0;
+
+    if (memory == NULL)
+    {
+        return;
+    }
+
+    slots = (BruterList*)memory->data[BR_MEMORY_SLOTS].p;
+
+    for (BruterInt i = 0; i < context->size; i++)
+    {
+        int8_t category = br_memory_category(context->types[i]);
+        BruterInt bytes = br_value_bytes(context->data[i], context->types[i]);
+
+        if (context->keys[i] != NULL)
+        {
+            keys += (BruterInt)(strlen(context->keys[i]) + 1);
+        }
+
+        // the per-variable accounting list is not a variable, so it is accounted with the memory list
+        if (context->data[i].p == (void*)memory)
+        {
+            bytes += br_list_bytes(slots);
+        }
+
+        // commands keep being accounted as baked code even though they are lists
+        if (i < slots->size && slots->data[i].i != 0 && category != -1 && category != BR_MEMORY_BUFFERS)
+        {
+            category = slots->types[i];
+        }
+
+        if (category == -1)
+        {
+            br_memory_detach(context, i);
+        }
+        else if (category == BR_MEMORY_BUFFERS)
+        {
+            continue;
+        }
+        else
+        {
+            br_memory_attach(context, i, category, bytes);
+        }
+    }
+
+    br_memory_track(context, BR_MEMORY_KEYS, keys - memory->data[BR_MEMORY_KEYS].i);
+}
+
+// lists can grow inside a command, so when there is a limit, the lists a command received are measured again after it
+// lists that grow without being passed as arguments are only noticed by br_memory_update
+STATIC_INLINE void br_memory_remeasure(BruterList *context, const BruterList *args)
+{
+    BruterList *memory = br_memory_list(context);
+    BruterList *slots = NULL;
+
+    if (memory == NULL || memory->data[BR_MEMORY_LIMIT].i <= 0)
+    {
+        return;
+    }
+
+    slots = (BruterList*)memory->data[BR_MEMORY_SLOTS].p;
+    for (BruterInt i = 0; i < br_arg_get_count(args); i++)
+    {
+        BruterInt index = br_arg_get_index(args, i);
+
+        if (index < 0 || index >= context->size || index >= slots->size || slots->data[index].i == 0)
+        {
+            continue;
+        }
+
+        switch (context->types[index])
+        {
+            case BR_TYPE_LIST:
+            case BR_TYPE_BAKED:
+            case BR_TYPE_USER_FUNCTION:
+                br_memory_attach(context, index, slots->types[index], br_list_bytes((BruterList*)context->data[index].p));
+                break;
+            default:
+                break;
+        }
+    }
+}
+
 #endif // BRUTER_AS_HEADER
 
 // just to avoid unused warnings